@@ -0,0 +1,93 @@
+#ifndef FRAME_SOURCE_HH
+#define FRAME_SOURCE_HH
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <FrameRecording.hh>
+
+#include <string>
+
+namespace {
+
+// Input frames from a recording (see FrameRecording.hh), a video or single image file
+// or a camera, behind the grab()/retrieve() interface of cv::VideoCapture
+class FrameSource
+{
+public:
+    // The first non-empty of recording and video is used, otherwise the camera
+    bool open(const std::string &recording, const std::string &video, int camId)
+    {
+        if (!recording.empty())
+        {
+            next_ = 0;
+            return reader_.open(recording);
+        }
+
+        if (!video.empty())
+        {
+            file_ = true;
+
+            // A still image is a one frame source
+            if (cv::haveImageReader(video))
+            {
+                still_ = cv::imread(video, cv::IMREAD_COLOR);
+                stillPending_ = !still_.empty();
+                return stillPending_;
+            }
+
+            return capture_.open(video);
+        }
+
+        return capture_.open(camId);
+    }
+
+    // Frames come from disk rather than a live camera
+    bool isFile() const
+    {
+        return file_ || reader_.isOpened();
+    }
+
+    bool grab()
+    {
+        if (reader_.isOpened())
+            return next_++ < reader_.size();
+        if (!still_.empty())
+        {
+            stillGrabbed_ = stillPending_;
+            stillPending_ = false;
+            return stillGrabbed_;
+        }
+        return capture_.grab();
+    }
+
+    // Recorded raw frames point straight into the mapped file and must not be written to
+    bool retrieve(cv::Mat &image)
+    {
+        if (reader_.isOpened())
+        {
+            if (next_ == 0 || next_ > reader_.size())
+                return false;
+            image = reader_.frame(next_ - 1);
+            return !image.empty();
+        }
+        if (!still_.empty())
+        {
+            image = still_;
+            return stillGrabbed_;
+        }
+        return capture_.retrieve(image);
+    }
+
+private:
+    RecordingReader reader_;
+    cv::VideoCapture capture_;
+    cv::Mat still_;
+    bool stillPending_ = false, stillGrabbed_ = false;
+    size_t next_ = 0;
+    bool file_ = false;
+};
+
+}
+
+#endif
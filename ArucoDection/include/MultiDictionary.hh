@@ -0,0 +1,303 @@
+#ifndef MULTI_DICTIONARY_HH
+#define MULTI_DICTIONARY_HH
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Detected marker id: (index into the dictionary list, id within that dictionary)
+typedef std::pair<int, int> MarkerId;
+
+// Highest predefined dictionary id the tools accept (DICT_ARUCO_ORIGINAL)
+const int MAX_DICTIONARY_ID = cv::aruco::DICT_ARUCO_ORIGINAL;
+
+// Parse a comma separated list of predefined dictionary ids, e.g. "0,8". The ids are kept
+// in dictionaryIds so a MarkerId's dictionary index can be mapped back to what the user passed.
+inline static bool parseDictionaries(const std::string &list, std::vector<cv::aruco::Dictionary> &dictionaries,
+                                     std::vector<int> &dictionaryIds)
+{
+    dictionaries.clear();
+    dictionaryIds.clear();
+
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        char *end;
+        long id = strtol(item.c_str(), &end, 10);
+        if (end == item.c_str() || *end != '\0' || id < 0 || id > MAX_DICTIONARY_ID)
+            return false;
+
+        dictionaries.push_back(cv::aruco::getPredefinedDictionary(cv::aruco::PredefinedDictionaryType(id)));
+        dictionaryIds.push_back((int)id);
+    }
+
+    return !dictionaries.empty();
+}
+
+// Sample the cells of a marker candidate, same as the aruco module does before identification
+inline static cv::Mat extractCandidateBits(const cv::Mat &grey, const std::vector<cv::Point2f> &corners,
+                                           int markerSize, const cv::aruco::DetectorParameters &params)
+{
+    int sizeWithBorders = markerSize + 2 * params.markerBorderBits;
+    int cellSize = params.perspectiveRemovePixelPerCell;
+    int cellMargin = int(params.perspectiveRemoveIgnoredMarginPerCell * cellSize);
+    int resultSize = sizeWithBorders * cellSize;
+
+    std::vector<cv::Point2f> resultCorners = {
+        cv::Point2f(0, 0), cv::Point2f((float)resultSize - 1, 0),
+        cv::Point2f((float)resultSize - 1, (float)resultSize - 1), cv::Point2f(0, (float)resultSize - 1)};
+
+    cv::Mat result;
+    cv::Mat transform = cv::getPerspectiveTransform(corners, resultCorners);
+    cv::warpPerspective(grey, result, transform, cv::Size(resultSize, resultSize), cv::INTER_NEAREST);
+
+    cv::Mat bits(sizeWithBorders, sizeWithBorders, CV_8UC1, cv::Scalar::all(0));
+
+    // Too little contrast for Otsu, the marker is a single colour
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(result(cv::Rect(cellSize / 2, cellSize / 2, resultSize - cellSize, resultSize - cellSize)),
+                   mean, stddev);
+    if (stddev[0] < params.minOtsuStdDev)
+    {
+        bits.setTo(mean[0] > 127 ? 1 : 0);
+        return bits;
+    }
+
+    cv::threshold(result, result, 125, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+
+    for (int y = 0; y < sizeWithBorders; y++)
+    {
+        for (int x = 0; x < sizeWithBorders; x++)
+        {
+            cv::Mat cell = result(cv::Rect(x * cellSize + cellMargin, y * cellSize + cellMargin,
+                                           cellSize - 2 * cellMargin, cellSize - 2 * cellMargin));
+            if ((size_t)cv::countNonZero(cell) > cell.total() / 2)
+                bits.at<uchar>(y, x) = 1;
+        }
+    }
+
+    return bits;
+}
+
+inline static int borderErrors(const cv::Mat &bits, int markerSize, int borderSize)
+{
+    int sizeWithBorders = markerSize + 2 * borderSize;
+    int errors = 0;
+
+    for (int y = 0; y < sizeWithBorders; y++)
+    {
+        for (int k = 0; k < borderSize; k++)
+        {
+            errors += bits.at<uchar>(y, k) != 0;
+            errors += bits.at<uchar>(y, sizeWithBorders - 1 - k) != 0;
+        }
+    }
+
+    for (int x = borderSize; x < sizeWithBorders - borderSize; x++)
+    {
+        for (int k = 0; k < borderSize; k++)
+        {
+            errors += bits.at<uchar>(k, x) != 0;
+            errors += bits.at<uchar>(sizeWithBorders - 1 - k, x) != 0;
+        }
+    }
+
+    return errors;
+}
+
+// Detect markers of several dictionaries in one pass.
+//
+// Thresholding, contour extraction and candidate filtering run once (through
+// detectMarkers with the first dictionary). The candidates it rejects are then
+// decoded against every other dictionary; the bits of a candidate are sampled once
+// per marker size and shared by all dictionaries of that size. A candidate belongs
+// to the first dictionary in the list that identifies it.
+//
+// The extra dictionaries honour detectInvertedMarker and CORNER_REFINE_SUBPIX like
+// detectMarkers does. CORNER_REFINE_CONTOUR and CORNER_REFINE_APRILTAG are only
+// implemented inside detectMarkers, so they are refused with several dictionaries.
+inline static void detectMultiDictionary(const cv::Mat &image,
+                                         const std::vector<cv::aruco::Dictionary> &dictionaries,
+                                         std::vector<std::vector<cv::Point2f>> &corners,
+                                         std::vector<MarkerId> &ids,
+                                         const cv::Ptr<cv::aruco::DetectorParameters> &params =
+                                             cv::makePtr<cv::aruco::DetectorParameters>())
+{
+    corners.clear();
+    ids.clear();
+
+    if (dictionaries.empty() || image.empty())
+        return;
+
+    CV_Assert(dictionaries.size() < 2 ||
+              params->cornerRefinementMethod == cv::aruco::CORNER_REFINE_NONE ||
+              params->cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX);
+
+    cv::Mat grey;
+    if (image.channels() == 3)
+        cv::cvtColor(image, grey, cv::COLOR_BGR2GRAY);
+    else
+        grey = image;
+
+    std::vector<int> firstIds;
+    std::vector<std::vector<cv::Point2f>> candidates;
+    cv::aruco::detectMarkers(grey, cv::makePtr<cv::aruco::Dictionary>(dictionaries[0]), corners, firstIds,
+                             params, candidates);
+
+    for (int id : firstIds)
+        ids.push_back(MarkerId(0, id));
+
+    if (dictionaries.size() < 2)
+        return;
+
+    size_t firstCount = corners.size();
+
+    for (auto &candidate : candidates)
+    {
+        std::map<int, cv::Mat> bitsBySize;
+
+        for (int d = 1; d < (int)dictionaries.size(); d++)
+        {
+            const cv::aruco::Dictionary &dictionary = dictionaries[d];
+            int markerSize = dictionary.markerSize;
+
+            auto found = bitsBySize.find(markerSize);
+            if (found == bitsBySize.end())
+                found = bitsBySize.insert(std::make_pair(markerSize,
+                    extractCandidateBits(grey, candidate, markerSize, *params))).first;
+            cv::Mat bits = found->second;
+
+            // A white-on-black marker has a white border, try it with the bits flipped
+            int maxBorderErrors = int(markerSize * markerSize * params->maxErroneousBitsInBorderRate);
+            if (borderErrors(bits, markerSize, params->markerBorderBits) > maxBorderErrors)
+            {
+                if (!params->detectInvertedMarker)
+                    continue;
+
+                // New buffer, assigning the expression to bits would flip the cached bits in place
+                cv::Mat inverted = 1 - bits;
+                bits = inverted;
+                if (borderErrors(bits, markerSize, params->markerBorderBits) > maxBorderErrors)
+                    continue;
+            }
+
+            int border = params->markerBorderBits;
+            cv::Mat onlyBits = bits(cv::Rect(border, border, markerSize, markerSize));
+
+            int id, rotation;
+            if (!dictionary.identify(onlyBits, id, rotation, params->errorCorrectionRate))
+                continue;
+
+            // Put the first corner at the top left of the marker
+            std::rotate(candidate.begin(), candidate.begin() + 4 - rotation, candidate.end());
+
+            // Inner and outer contours of one marker can both survive candidate filtering
+            bool duplicate = false;
+            cv::Point2f center = (candidate[0] + candidate[1] + candidate[2] + candidate[3]) * 0.25f;
+            for (size_t i = firstCount; i < corners.size() && !duplicate; i++)
+            {
+                cv::Point2f other = (corners[i][0] + corners[i][1] + corners[i][2] + corners[i][3]) * 0.25f;
+                duplicate = ids[i] == MarkerId(d, id) &&
+                            cv::norm(center - other) < 0.5 * cv::norm(corners[i][0] - corners[i][1]);
+            }
+
+            if (!duplicate)
+            {
+                corners.push_back(candidate);
+                ids.push_back(MarkerId(d, id));
+            }
+            break;
+        }
+    }
+
+    if (params->cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX)
+    {
+        cv::TermCriteria criteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+                                  params->cornerRefinementMaxIterations, params->cornerRefinementMinAccuracy);
+        int winSize = params->cornerRefinementWinSize;
+
+        for (size_t i = firstCount; i < corners.size(); i++)
+            cv::cornerSubPix(grey, corners[i], cv::Size(winSize, winSize), cv::Size(-1, -1), criteria);
+    }
+}
+
+// Reference for detectMultiDictionary: one full detectMarkers run per dictionary, a marker
+// already found by an earlier dictionary in the list is not reported again. Much slower,
+// only meant to check the single-pass decoder.
+inline static void detectEachDictionary(const cv::Mat &image,
+                                        const std::vector<cv::aruco::Dictionary> &dictionaries,
+                                        std::vector<std::vector<cv::Point2f>> &corners,
+                                        std::vector<MarkerId> &ids,
+                                        const cv::Ptr<cv::aruco::DetectorParameters> &params =
+                                            cv::makePtr<cv::aruco::DetectorParameters>())
+{
+    corners.clear();
+    ids.clear();
+
+    for (int d = 0; d < (int)dictionaries.size(); d++)
+    {
+        std::vector<int> found;
+        std::vector<std::vector<cv::Point2f>> foundCorners;
+        cv::aruco::detectMarkers(image, cv::makePtr<cv::aruco::Dictionary>(dictionaries[d]), foundCorners, found,
+                                 params);
+
+        size_t claimed = corners.size();
+        for (size_t i = 0; i < found.size(); i++)
+        {
+            const std::vector<cv::Point2f> &c = foundCorners[i];
+            cv::Point2f center = (c[0] + c[1] + c[2] + c[3]) * 0.25f;
+
+            bool seen = false;
+            for (size_t j = 0; j < claimed && !seen; j++)
+            {
+                cv::Point2f other = (corners[j][0] + corners[j][1] + corners[j][2] + corners[j][3]) * 0.25f;
+                seen = cv::norm(center - other) < 0.5 * cv::norm(corners[j][0] - corners[j][1]);
+            }
+
+            if (!seen)
+            {
+                corners.push_back(c);
+                ids.push_back(MarkerId(d, found[i]));
+            }
+        }
+    }
+}
+
+// Draw the markers of each dictionary in its own colour
+inline static void drawMultiDictionaryMarkers(cv::Mat &image, const std::vector<std::vector<cv::Point2f>> &corners,
+                                              const std::vector<MarkerId> &ids, int numDictionaries)
+{
+    static const cv::Scalar colors[] = {
+        cv::Scalar(0, 255, 0), cv::Scalar(255, 0, 255), cv::Scalar(255, 255, 0), cv::Scalar(0, 128, 255)};
+
+    for (int d = 0; d < numDictionaries; d++)
+    {
+        std::vector<std::vector<cv::Point2f>> dictCorners;
+        std::vector<int> dictIds;
+        for (size_t i = 0; i < ids.size(); i++)
+        {
+            if (ids[i].first == d)
+            {
+                dictCorners.push_back(corners[i]);
+                dictIds.push_back(ids[i].second);
+            }
+        }
+
+        if (!dictIds.empty())
+            cv::aruco::drawDetectedMarkers(image, dictCorners, dictIds, colors[d % 4]);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef TILED_DETECTION_HH
+#define TILED_DETECTION_HH
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <MultiDictionary.hh>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+// Detect markers on overlapping tiles of the frame in parallel.
+//
+// The frame is cut into a grid of tileSize x tileSize cores. Every tile is detected on
+// its core grown by the largest expected marker plus the adaptive threshold window,
+// so a marker whose center lies in a core is completely visible, with the same
+// threshold neighbourhood, in that tile. Markers are only kept by the tile whose core
+// holds their center, which removes the copies seen by neighbouring tiles.
+// A tileSize of 0, or one that covers the frame, detects on the whole frame.
+inline static void detectTiled(const cv::Mat &image,
+                               const std::vector<cv::aruco::Dictionary> &dictionaries,
+                               std::vector<std::vector<cv::Point2f>> &corners,
+                               std::vector<MarkerId> &ids,
+                               int tileSize, int maxMarkerSize,
+                               const cv::Ptr<cv::aruco::DetectorParameters> &params =
+                                   cv::makePtr<cv::aruco::DetectorParameters>())
+{
+    if (tileSize <= 0 || (image.cols <= tileSize && image.rows <= tileSize))
+    {
+        detectMultiDictionary(image, dictionaries, corners, ids, params);
+        return;
+    }
+
+    corners.clear();
+    ids.clear();
+
+    // Convert once instead of once per tile
+    cv::Mat grey;
+    if (image.channels() == 3)
+        cv::cvtColor(image, grey, cv::COLOR_BGR2GRAY);
+    else
+        grey = image;
+
+    int overlap = maxMarkerSize + params->adaptiveThreshWinSizeMax;
+    cv::Rect frame(0, 0, grey.cols, grey.rows);
+
+    std::vector<cv::Rect> cores, tiles;
+    for (int y = 0; y < grey.rows; y += tileSize)
+    {
+        for (int x = 0; x < grey.cols; x += tileSize)
+        {
+            cv::Rect core = cv::Rect(x, y, tileSize, tileSize) & frame;
+            cores.push_back(core);
+            tiles.push_back(cv::Rect(core.x - overlap, core.y - overlap,
+                                     core.width + 2 * overlap, core.height + 2 * overlap) & frame);
+        }
+    }
+
+    std::vector<std::vector<std::vector<cv::Point2f>>> tileCorners(tiles.size());
+    std::vector<std::vector<MarkerId>> tileIds(tiles.size());
+
+    cv::parallel_for_(cv::Range(0, (int)tiles.size()), [&](const cv::Range &range) {
+        for (int t = range.start; t < range.end; t++)
+        {
+            const cv::Rect &tile = tiles[t];
+            const cv::Rect &core = cores[t];
+
+            // Perimeter limits are relative to the image size, rescale them so a tile
+            // accepts the same marker sizes as the whole frame
+            cv::Ptr<cv::aruco::DetectorParameters> tileParams = cv::makePtr<cv::aruco::DetectorParameters>(*params);
+            double scale = std::max(frame.width, frame.height) / (double)std::max(tile.width, tile.height);
+            tileParams->minMarkerPerimeterRate *= scale;
+            tileParams->maxMarkerPerimeterRate *= scale;
+
+            std::vector<std::vector<cv::Point2f>> found;
+            std::vector<MarkerId> foundIds;
+            detectMultiDictionary(grey(tile), dictionaries, found, foundIds, tileParams);
+
+            for (size_t i = 0; i < found.size(); i++)
+            {
+                cv::Point2f offset((float)tile.x, (float)tile.y);
+                cv::Point2f center(0, 0);
+                for (auto &corner : found[i])
+                {
+                    corner += offset;
+                    center += corner * 0.25f;
+                }
+
+                if (center.x >= core.x && center.x < core.x + core.width &&
+                    center.y >= core.y && center.y < core.y + core.height)
+                {
+                    tileCorners[t].push_back(found[i]);
+                    tileIds[t].push_back(foundIds[i]);
+                }
+            }
+        }
+    }, (double)tiles.size());
+
+    for (size_t t = 0; t < tiles.size(); t++)
+    {
+        corners.insert(corners.end(), tileCorners[t].begin(), tileCorners[t].end());
+        ids.insert(ids.end(), tileIds[t].begin(), tileIds[t].end());
+    }
+}
+
+// True if both detections hold the same markers with corners within tolerance pixels,
+// regardless of order. Used to check tiled detection against whole-frame detection.
+// Without corner refinement the corners are contour pixels, so by default they have
+// to match exactly.
+inline static bool sameDetections(const std::vector<std::vector<cv::Point2f>> &cornersA, const std::vector<MarkerId> &idsA,
+                                  const std::vector<std::vector<cv::Point2f>> &cornersB, const std::vector<MarkerId> &idsB,
+                                  float tolerance = 0.f)
+{
+    if (idsA.size() != idsB.size())
+        return false;
+
+    std::vector<bool> matched(idsB.size(), false);
+    for (size_t i = 0; i < idsA.size(); i++)
+    {
+        bool found = false;
+        for (size_t j = 0; j < idsB.size() && !found; j++)
+        {
+            if (matched[j] || idsA[i] != idsB[j])
+                continue;
+
+            found = true;
+            for (int k = 0; k < 4 && found; k++)
+                found = cv::norm(cornersA[i][k] - cornersB[j][k]) <= tolerance;
+
+            matched[j] = found;
+        }
+
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+}
+
+#endif
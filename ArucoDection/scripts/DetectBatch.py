@@ -0,0 +1,48 @@
+import argparse
+import cv2
+import aruco_native  # build with -DBUILD_PYTHON_BINDINGS=ON, then add the build dir to PYTHONPATH
+
+
+# construct the argument parser and parse the arguments
+ap = argparse.ArgumentParser()
+ap.add_argument("-v", "--video", type=str, default=None,
+    help="Input video file, if ommited, input comes from camera")
+ap.add_argument("-r", "--recording", type=str, default=None,
+    help="Input recording file (capture_images -f rec), read without copying raw frames")
+ap.add_argument("-d", "--dictionaries", type=int, nargs="+", default=[0],
+    help="Dictionaries to detect, e.g. 0 8 (DICT_4X4_50=0, DICT_6X6_50=8)")
+ap.add_argument("-b", "--batch", type=int, default=8,
+    help="Number of frames detected together on native threads")
+ap.add_argument("-ts", "--tile-size", type=int, default=0,
+    help="Tile size in pixels for tiled detection, 0 detects on the whole frame")
+args = ap.parse_args()
+
+if args.recording:
+    recording = aruco_native.RecordingReader(args.recording)
+    frameIter = iter(recording)
+else:
+    cap = cv2.VideoCapture(args.video if args.video else 0)
+    frameIter = iter(lambda: cap.read()[1], None)
+seq = 0 # Sequence number of the first frame in the batch
+
+while True:
+    ## Frames are handed to the native module as they are, without copies
+    frames = []
+    while len(frames) < args.batch:
+        frame = next(frameIter, None)
+        if frame is None:
+            break
+        frames.append(frame)
+
+    if not frames:
+        break
+
+    results = aruco_native.detect_batch(frames, dictionaries=args.dictionaries, tile_size=args.tile_size)
+
+    for i, (corners, ids) in enumerate(results):
+        for dictionary, tag in ids:
+            print(f'frame {seq + i}: dictionary {args.dictionaries[dictionary]} tag {tag}')
+
+    seq += len(frames)
+
+cap.release()
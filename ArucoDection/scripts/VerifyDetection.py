@@ -0,0 +1,81 @@
+import argparse
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+import cv2
+import numpy as np
+
+
+# construct the argument parser and parse the arguments
+ap = argparse.ArgumentParser()
+ap.add_argument("-b", "--detect-tags", type=str, default="build/detect_tags",
+    help="Path to the detect_tags binary")
+ap.add_argument("-s", "--marker-size", type=int, default=120,
+    help="Side of the generated markers in pixels")
+ap.add_argument("-ts", "--tile-sizes", type=int, nargs="+", default=[64, 128, 256],
+    help="Tile sizes to check tiled detection with")
+args = ap.parse_args()
+
+# DICT_4X4_50=0 and DICT_6X6_50=8, with the same ids in both so only the dictionary tells them apart
+DICTIONARIES = [0, 8]
+IDS = [0, 1, 2, 3, 17, 42]
+
+
+def markerImage(dictionary, tag, side):
+    d = cv2.aruco.getPredefinedDictionary(dictionary)
+    if hasattr(cv2.aruco, "generateImageMarker"):
+        return cv2.aruco.generateImageMarker(d, tag, side)
+    return cv2.aruco.drawMarker(d, tag, side)
+
+
+def mixedImage(side):
+    ## One row of markers per dictionary on a white page, a marker wide gap between them
+    gap = side
+    rows, cols = len(DICTIONARIES), len(IDS)
+    page = np.full((rows * (side + gap) + gap, cols * (side + gap) + gap), 255, np.uint8)
+
+    for r, dictionary in enumerate(DICTIONARIES):
+        for c, tag in enumerate(IDS):
+            y, x = gap + r * (side + gap), gap + c * (side + gap)
+            page[y:y + side, x:x + side] = markerImage(dictionary, tag, side)
+
+    return page
+
+
+def run(name, command):
+    result = subprocess.run(command, capture_output=True, text=True)
+    print(f'{"ok  " if result.returncode == 0 else "FAIL"} {name}')
+    if result.returncode != 0:
+        sys.stdout.write(result.stdout)
+        sys.stderr.write(result.stderr)
+    return result.returncode == 0
+
+
+failures = 0
+
+with tempfile.TemporaryDirectory() as tmp:
+    mixed = os.path.join(tmp, "mixed.png")
+    cv2.imwrite(mixed, mixedImage(args.marker_size))
+
+    ## Single-pass decoding against one detectMarkers run per dictionary, in both list orders
+    for order in (DICTIONARIES, DICTIONARIES[::-1]):
+        dl = ",".join(str(d) for d in order)
+        if not run(f'dictionaries {dl}', [args.detect_tags, "-hl", "-vd", f'-dl={dl}', f'-v={mixed}']):
+            failures += 1
+
+## Tiled detection against whole-frame detection on the images shipped with the repo
+here = os.path.dirname(os.path.abspath(__file__))
+images = sorted(glob.glob(os.path.join(here, "..", "imgs", "*")) + glob.glob(os.path.join(here, "images", "*.png")))
+
+for image in images:
+    for ts in args.tile_sizes:
+        name = f'{os.path.relpath(image, os.path.join(here, ".."))} -ts {ts}'
+        if not run(name, [args.detect_tags, "-hl", "-vt", f'-ts={ts}', f'-dl={",".join(str(d) for d in DICTIONARIES)}',
+                          f'-v={image}']):
+            failures += 1
+
+print(f'{failures} failed')
+sys.exit(1 if failures else 0)
@@ -10,6 +10,7 @@
 #include <opencv2/core/core.hpp>
 
 #include <ArucoUtils.hh>
+#include <FrameSource.hh>
 
 #include <vector>
 #include <iostream>
@@ -36,6 +37,7 @@ const char* keys  =
         "{@outfile |<none> | Output file with calibrated camera parameters }"
         "{v        |       | Input from video file, if ommited, input comes from camera }"
         "{ci       | 0     | Camera id if input doesnt come from video (-v) }"
+        "{r        |       | Input from a recording file (capture_images -f rec) }"
         "{dp       |       | File of marker detector parameters }"
         "{rs       | false | Apply refind strategy }"
         "{zt       | false | Assume zero tangential distortion }"
@@ -109,10 +111,12 @@ int main(int argc, char **argv)
     bool refindStrategy = parser.get<bool>("rs");
     int camId = parser.get<int>("ci");
 
-    cv::String video;
+    cv::String video, recording;
 
     if (parser.has("v"))
         video = parser.get<cv::String>("v");
+    if (parser.has("r"))
+        recording = parser.get<cv::String>("r");
 
     if (!parser.check())
     {
@@ -120,18 +124,13 @@ int main(int argc, char **argv)
         return 0;
     }
 
-    cv::VideoCapture inputVideo;
-    int waitTime;
-
-    if (!video.empty())
-    {
-        inputVideo.open(video);
-        waitTime = 0;
-    } else
+    FrameSource inputVideo;
+    if (!inputVideo.open(recording, video, camId))
     {
-        inputVideo.open(camId);
-        waitTime = 10;
+        std::cerr << "Cannot open input" << std::endl;
+        return -1;
     }
+    int waitTime = inputVideo.isFile() ? 0 : 10;
 
     cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(0);
     if (parser.has("d"))
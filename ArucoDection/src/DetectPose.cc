@@ -3,13 +3,29 @@
 #include <opencv2/aruco.hpp>
 
 #include <ArucoUtils.hh>
+#include <FrameSource.hh>
+#include <MultiDictionary.hh>
+#include <TiledDetection.hh>
+
+#include <cstdlib>
+#include <sstream>
 
 namespace {
     const char *about = "Aruco detection module motivated by the OpenCV library";
 
     const char *keys =
         "{@cameraParams |<none> | Camera calibrated parameters for pose detection }"
-        "{d             |false  | Enable debug mode}";
+        "{d             |false  | Enable debug mode}"
+        "{v             |       | Input from video or image file, if ommited, input comes from camera }"
+        "{r             |       | Input from a recording file (capture_images -f rec) }"
+        "{ci            |0      | Camera id if input doesnt come from video (-v) or recording (-r) }"
+        "{dl            |0      | Comma separated dictionaries, e.g. 0,8: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
+        "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
+        "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
+        "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16 }"
+        "{ml            |0.052  | Marker side length (in meters), comma separated to give one length per -dl dictionary }"
+        "{ts            |0      | Tile size (in pixels) for parallel tiled detection, 0 detects on the whole frame }"
+        "{mm            |200    | Largest expected marker side (in pixels), tiles overlap by this much }";
 }
 
 int main(int argc, char **argv)
@@ -29,13 +45,54 @@ int main(int argc, char **argv)
     if (parser.has("d"))
         debug = parser.get<bool>("d");
 
+    std::string video, recording;
+    if (parser.has("v"))
+        video = parser.get<std::string>("v");
+    if (parser.has("r"))
+        recording = parser.get<std::string>("r");
+
     // Configure video input
-    cv::VideoCapture inputVideo;
-    inputVideo.open(0);
+    FrameSource inputVideo;
+    if (!inputVideo.open(recording, video, parser.get<int>("ci")))
+    {
+        std::cerr << "Cannot open input" << std::endl;
+        return -1;
+    }
 
-    // Get predefined dictionary
-    cv::aruco::Dictionary dictionary
-        = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+    // Get predefined dictionaries, all of them are decoded in a single detection pass
+    std::vector<cv::aruco::Dictionary> dictionaries;
+    std::vector<int> dictionaryIds;
+    if (!parseDictionaries(parser.get<std::string>("dl"), dictionaries, dictionaryIds))
+    {
+        std::cerr << "Invalid dictionary list " << parser.get<std::string>("dl") << std::endl;
+        return -1;
+    }
+
+    // Marker side length per dictionary, a single value applies to all of them
+    std::vector<float> markerLengths;
+    std::stringstream lengths(parser.get<std::string>("ml"));
+    std::string length;
+    bool lengthsOk = true;
+    while (std::getline(lengths, length, ','))
+    {
+        char *end;
+        float value = strtof(length.c_str(), &end);
+        lengthsOk = lengthsOk && end != length.c_str() && *end == '\0' && value > 0;
+        markerLengths.push_back(value);
+    }
+
+    if (markerLengths.size() == 1)
+        markerLengths.resize(dictionaries.size(), markerLengths[0]);
+
+    if (!lengthsOk || markerLengths.size() != dictionaries.size())
+    {
+        std::cerr << "Invalid marker lengths " << parser.get<std::string>("ml")
+                  << ", give one length or one per dictionary" << std::endl;
+        return -1;
+    }
+
+    int tileSize = parser.get<int>("ts");
+    int maxMarkerSize = parser.get<int>("mm");
 
     // Camera calibrations for pose estimation
     cv::Mat cameraMatrix, distCoeffs;
@@ -52,28 +109,46 @@ int main(int argc, char **argv)
         image.copyTo(imageCopy);
 
         // Vec to store ids
-        std::vector<int> ids;
+        std::vector<MarkerId> ids;
         std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(image, cv::makePtr<cv::aruco::Dictionary>(dictionary), corners, ids);
+        detectTiled(image, dictionaries, corners, ids, tileSize, maxMarkerSize);
 
         // if at least one marker detected
         if (ids.size() > 0)
         {
-            cv::aruco::drawDetectedMarkers(imageCopy, corners, ids);
+            drawMultiDictionaryMarkers(imageCopy, corners, ids, dictionaries.size());
 
-            std::vector<cv::Vec3d> rvecs, tvecs;
-            cv::aruco::estimatePoseSingleMarkers(corners, 0.0520, cameraMatrix, distCoeffs, rvecs, tvecs);
-
-            if (rvecs.size() == tvecs.size())
+            // Markers of each dictionary are posed with that dictionary's side length
+            for (int d = 0; d < (int)dictionaries.size(); d++)
             {
-                for(int i = 0; i < ids.size(); i++)
+                std::vector<std::vector<cv::Point2f>> dictCorners;
+                std::vector<int> dictTags;
+                for (size_t i = 0; i < ids.size(); i++)
                 {
-                    cv::drawFrameAxes(imageCopy, cameraMatrix, distCoeffs, rvecs[i], tvecs[i], 0.05);
-
-                    std::cout << "Tag ID: " << ids[i] << std::endl;
-                    std::cout << "x: " << tvecs[i][0] <<"\ty: " << tvecs[i][1] << "\tz: " << tvecs[i][2] << std::endl;
+                    if (ids[i].first == d)
+                    {
+                        dictCorners.push_back(corners[i]);
+                        dictTags.push_back(ids[i].second);
+                    }
                 }
 
+                if (dictCorners.empty())
+                    continue;
+
+                std::vector<cv::Vec3d> rvecs, tvecs;
+                cv::aruco::estimatePoseSingleMarkers(dictCorners, markerLengths[d], cameraMatrix, distCoeffs,
+                                                     rvecs, tvecs);
+
+                if (rvecs.size() == tvecs.size())
+                {
+                    for(int i = 0; i < rvecs.size(); i++)
+                    {
+                        cv::drawFrameAxes(imageCopy, cameraMatrix, distCoeffs, rvecs[i], tvecs[i], markerLengths[d]);
+
+                        std::cout << "Dictionary: " << dictionaryIds[d] << "\tTag ID: " << dictTags[i] << std::endl;
+                        std::cout << "x: " << tvecs[i][0] <<"\ty: " << tvecs[i][1] << "\tz: " << tvecs[i][2] << std::endl;
+                    }
+                }
             }
         }
 
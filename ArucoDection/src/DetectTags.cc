@@ -3,16 +3,70 @@
 #include <opencv2/aruco.hpp>
 
 #include <ArucoUtils.hh>
+#include <FrameSource.hh>
+#include <MultiDictionary.hh>
+#include <TiledDetection.hh>
+
+namespace {
+    const char *about = "Detect ArUco tags from a camera, video or recording";
+
+    const char *keys =
+        "{v             |       | Input from video or image file, if ommited, input comes from camera }"
+        "{help h usage ? |      | print this message }"
+        "{r             |       | Input from a recording file (capture_images -f rec) }"
+        "{ci            |0      | Camera id if input doesnt come from video (-v) or recording (-r) }"
+        "{dl            |0      | Comma separated dictionaries, e.g. 0,8: DICT_4X4_50=0, DICT_4X4_100=1, DICT_4X4_250=2,"
+        "DICT_4X4_1000=3, DICT_5X5_50=4, DICT_5X5_100=5, DICT_5X5_250=6, DICT_5X5_1000=7, "
+        "DICT_6X6_50=8, DICT_6X6_100=9, DICT_6X6_250=10, DICT_6X6_1000=11, DICT_7X7_50=12,"
+        "DICT_7X7_100=13, DICT_7X7_250=14, DICT_7X7_1000=15, DICT_ARUCO_ORIGINAL = 16 }"
+        "{ts            |0      | Tile size (in pixels) for parallel tiled detection, 0 detects on the whole frame }"
+        "{mm            |200    | Largest expected marker side (in pixels), tiles overlap by this much }"
+        "{vt            |false  | Verify tiled detection against whole-frame detection }"
+        "{vd            |false  | Verify single-pass detection against one detectMarkers run per dictionary }"
+        "{hl            |false  | Headless: no display, with -vt/-vd the exit status reports mismatches }";
+}
 
 int main(int argc, char **argv)
 {
+    // command line arguments
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    if (parser.has("help"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+
+    std::string video, recording;
+    if (parser.has("v"))
+        video = parser.get<std::string>("v");
+    if (parser.has("r"))
+        recording = parser.get<std::string>("r");
+
     // Configure video input
-    cv::VideoCapture inputVideo;
-    inputVideo.open(0);
+    FrameSource inputVideo;
+    if (!inputVideo.open(recording, video, parser.get<int>("ci")))
+    {
+        std::cerr << "Cannot open input" << std::endl;
+        return -1;
+    }
 
-    // Get predefined dictionary
-    cv::aruco::Dictionary dictionary
-        = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+    // Get predefined dictionaries, all of them are decoded in a single detection pass
+    std::vector<cv::aruco::Dictionary> dictionaries;
+    std::vector<int> dictionaryIds;
+    if (!parseDictionaries(parser.get<std::string>("dl"), dictionaries, dictionaryIds))
+    {
+        std::cerr << "Invalid dictionary list " << parser.get<std::string>("dl") << std::endl;
+        return -1;
+    }
+
+    int tileSize = parser.get<int>("ts");
+    int maxMarkerSize = parser.get<int>("mm");
+    bool verifyTiles = parser.get<bool>("vt");
+    bool verifyDictionaries = parser.get<bool>("vd");
+    bool headless = parser.get<bool>("hl");
+    int mismatches = 0, dictionaryMismatches = 0;
 
     while (inputVideo.grab())
     {
@@ -22,13 +76,45 @@ int main(int argc, char **argv)
         image.copyTo(imageCopy);
 
         // Vec to store ids
-        std::vector<int> ids;
+        std::vector<MarkerId> ids;
         std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(image, cv::makePtr<cv::aruco::Dictionary>(dictionary), corners, ids);
+        detectTiled(image, dictionaries, corners, ids, tileSize, maxMarkerSize);
+
+        if (verifyTiles && tileSize > 0)
+        {
+            std::vector<MarkerId> wholeIds;
+            std::vector<std::vector<cv::Point2f>> wholeCorners;
+            detectMultiDictionary(image, dictionaries, wholeCorners, wholeIds);
+
+            if (!sameDetections(corners, ids, wholeCorners, wholeIds))
+            {
+                mismatches++;
+                std::cerr << "Tiled detection differs from whole frame: " << ids.size()
+                          << " vs " << wholeIds.size() << " markers" << std::endl;
+            }
+        }
+
+        if (verifyDictionaries)
+        {
+            std::vector<MarkerId> singleIds, eachIds;
+            std::vector<std::vector<cv::Point2f>> singleCorners, eachCorners;
+            detectMultiDictionary(image, dictionaries, singleCorners, singleIds);
+            detectEachDictionary(image, dictionaries, eachCorners, eachIds);
+
+            if (!sameDetections(singleCorners, singleIds, eachCorners, eachIds))
+            {
+                dictionaryMismatches++;
+                std::cerr << "Single-pass detection differs from per-dictionary detection: " << singleIds.size()
+                          << " vs " << eachIds.size() << " markers" << std::endl;
+            }
+        }
+
+        if (headless)
+            continue;
 
         // if at least one marker detected
         if (ids.size() > 0)
-            cv::aruco::drawDetectedMarkers(imageCopy, corners, ids);
+            drawMultiDictionaryMarkers(imageCopy, corners, ids, dictionaries.size());
 
         cv::resize(imageCopy, imageCopy, cv::Size(), 0.6, 0.6);
 
@@ -40,6 +126,10 @@ int main(int argc, char **argv)
             break;
     }
 
+    if (verifyTiles && tileSize > 0)
+        std::cout << "Frames with tiled/whole-frame mismatches: " << mismatches << std::endl;
+    if (verifyDictionaries)
+        std::cout << "Frames with single-pass/per-dictionary mismatches: " << dictionaryMismatches << std::endl;
 
-    return 0;
+    return mismatches > 0 || dictionaryMismatches > 0;
 }
\ No newline at end of file
@@ -0,0 +1,324 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/aruco.hpp>
+
+#include <ArucoUtils.hh>
+#include <FrameRecording.hh>
+#include <MultiDictionary.hh>
+#include <TiledDetection.hh>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace {
+
+// A cv::Mat over an exported Python buffer. The buffer_info holds the export, so the
+// memory cannot be resized or freed while detection runs without the GIL. It has to
+// be destroyed with the GIL held.
+struct BufferFrame
+{
+    py::buffer_info info;
+    cv::Mat mat;
+};
+
+// Wrap a uint8 HxW grey or HxWx3 BGR buffer in a cv::Mat without copying. Rows may be
+// padded but pixels and channels have to be packed, as cv::Mat requires.
+BufferFrame frameFromBuffer(const py::buffer &buffer)
+{
+    BufferFrame frame;
+    frame.info = buffer.request();
+    py::buffer_info &info = frame.info;
+
+    if (info.itemsize != 1 || info.format != py::format_descriptor<uint8_t>::format())
+        throw py::value_error("image must be a uint8 array");
+    if (info.ndim != 2 && info.ndim != 3)
+        throw py::value_error("image must have shape (rows, cols) or (rows, cols, channels)");
+
+    int rows = (int)info.shape[0];
+    int cols = (int)info.shape[1];
+    int channels = info.ndim == 3 ? (int)info.shape[2] : 1;
+
+    // The detector only takes grey or BGR images
+    if (channels != 1 && channels != 3)
+        throw py::value_error("image must have 1 (grey) or 3 (BGR) channels");
+    if ((info.ndim == 3 && info.strides[2] != 1) || info.strides[1] != channels || info.strides[0] < cols * channels)
+        throw py::value_error("image pixels must be contiguous, use numpy.ascontiguousarray");
+
+    frame.mat = cv::Mat(rows, cols, CV_8UC(channels), info.ptr, (size_t)info.strides[0]);
+    return frame;
+}
+
+std::vector<cv::aruco::Dictionary> dictionariesFromIds(const std::vector<int> &dictionaryIds)
+{
+    if (dictionaryIds.empty())
+        throw py::value_error("at least one dictionary is required");
+
+    std::vector<cv::aruco::Dictionary> dictionaries;
+    for (int id : dictionaryIds)
+    {
+        if (id < 0 || id > MAX_DICTIONARY_ID)
+            throw py::value_error("unknown dictionary " + std::to_string(id));
+        dictionaries.push_back(cv::aruco::getPredefinedDictionary(cv::aruco::PredefinedDictionaryType(id)));
+    }
+    return dictionaries;
+}
+
+struct Detections
+{
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<MarkerId> ids;
+};
+
+// corners as an (N, 4, 2) float32 array, ids as an (N, 2) int32 array of (dictionary index, id)
+py::tuple toPython(const Detections &detections)
+{
+    py::ssize_t n = detections.ids.size();
+    py::array_t<float> corners({n, (py::ssize_t)4, (py::ssize_t)2});
+    py::array_t<int32_t> ids({n, (py::ssize_t)2});
+
+    auto c = corners.mutable_unchecked<3>();
+    auto d = ids.mutable_unchecked<2>();
+    for (py::ssize_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            c(i, k, 0) = detections.corners[i][k].x;
+            c(i, k, 1) = detections.corners[i][k].y;
+        }
+        d(i, 0) = detections.ids[i].first;
+        d(i, 1) = detections.ids[i].second;
+    }
+
+    return py::make_tuple(corners, ids);
+}
+
+py::tuple detect(const py::buffer &image, const std::vector<int> &dictionaryIds, int tileSize, int maxMarkerSize)
+{
+    BufferFrame frame = frameFromBuffer(image);
+    std::vector<cv::aruco::Dictionary> dictionaries = dictionariesFromIds(dictionaryIds);
+
+    Detections detections;
+    {
+        py::gil_scoped_release release;
+        detectTiled(frame.mat, dictionaries, detections.corners, detections.ids, tileSize, maxMarkerSize);
+    }
+
+    return toPython(detections);
+}
+
+py::list detectBatch(const std::vector<py::buffer> &images, const std::vector<int> &dictionaryIds,
+                     int tileSize, int maxMarkerSize)
+{
+    // The exports stay held in frames until the GIL is back
+    std::vector<BufferFrame> frames;
+    frames.reserve(images.size());
+    for (auto &image : images)
+        frames.push_back(frameFromBuffer(image));
+    std::vector<cv::aruco::Dictionary> dictionaries = dictionariesFromIds(dictionaryIds);
+
+    std::vector<Detections> detections(frames.size());
+    {
+        py::gil_scoped_release release;
+
+        // Tiles of a frame run serially inside this loop, OpenCV does not nest parallel regions
+        cv::parallel_for_(cv::Range(0, (int)frames.size()), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; i++)
+                detectTiled(frames[i].mat, dictionaries, detections[i].corners, detections[i].ids,
+                            tileSize, maxMarkerSize);
+        }, (double)frames.size());
+    }
+
+    py::list results;
+    for (auto &d : detections)
+        results.append(toPython(d));
+    return results;
+}
+
+py::tuple estimatePose(py::array_t<float, py::array::c_style | py::array::forcecast> corners, float markerLength,
+                       py::array_t<double, py::array::c_style | py::array::forcecast> cameraMatrix,
+                       py::array_t<double, py::array::c_style | py::array::forcecast> distCoeffs)
+{
+    if (corners.ndim() != 3 || corners.shape(1) != 4 || corners.shape(2) != 2)
+        throw py::value_error("corners must have shape (N, 4, 2)");
+    if (cameraMatrix.size() != 9)
+        throw py::value_error("camera matrix must be 3x3");
+
+    auto c = corners.unchecked<3>();
+    std::vector<std::vector<cv::Point2f>> markerCorners(corners.shape(0));
+    for (py::ssize_t i = 0; i < corners.shape(0); i++)
+        for (int k = 0; k < 4; k++)
+            markerCorners[i].push_back(cv::Point2f(c(i, k, 0), c(i, k, 1)));
+
+    cv::Mat K(3, 3, CV_64F, (void *)cameraMatrix.data());
+    cv::Mat D;
+    if (distCoeffs.size() > 0)
+        D = cv::Mat(1, (int)distCoeffs.size(), CV_64F, (void *)distCoeffs.data());
+
+    std::vector<cv::Vec3d> rvecs, tvecs;
+    {
+        py::gil_scoped_release release;
+        if (!markerCorners.empty())
+            cv::aruco::estimatePoseSingleMarkers(markerCorners, markerLength, K, D, rvecs, tvecs);
+    }
+
+    py::ssize_t n = rvecs.size();
+    py::array_t<double> r({n, (py::ssize_t)3}), t({n, (py::ssize_t)3});
+    auto rv = r.mutable_unchecked<2>();
+    auto tv = t.mutable_unchecked<2>();
+    for (py::ssize_t i = 0; i < n; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            rv(i, k) = rvecs[i][k];
+            tv(i, k) = tvecs[i][k];
+        }
+    }
+
+    return py::make_tuple(r, t);
+}
+
+py::tuple loadCameraParameters(const std::string &filename)
+{
+    cv::Mat cameraMatrix, distCoeffs;
+    if (!readCameraParameters(filename, cameraMatrix, distCoeffs) || cameraMatrix.empty())
+        throw py::value_error("cannot read camera parameters from " + filename);
+
+    cameraMatrix.convertTo(cameraMatrix, CV_64F);
+    distCoeffs.convertTo(distCoeffs, CV_64F);
+
+    py::array_t<double> K({(py::ssize_t)3, (py::ssize_t)3});
+    py::array_t<double> D((py::ssize_t)distCoeffs.total());
+    std::copy(cameraMatrix.begin<double>(), cameraMatrix.end<double>(), K.mutable_data());
+    std::copy(distCoeffs.begin<double>(), distCoeffs.end<double>(), D.mutable_data());
+
+    return py::make_tuple(K, D);
+}
+
+py::dtype dtypeFromDepth(int depth)
+{
+    switch (depth)
+    {
+    case CV_8U: return py::dtype::of<uint8_t>();
+    case CV_8S: return py::dtype::of<int8_t>();
+    case CV_16U: return py::dtype::of<uint16_t>();
+    case CV_16S: return py::dtype::of<int16_t>();
+    case CV_32S: return py::dtype::of<int32_t>();
+    case CV_32F: return py::dtype::of<float>();
+    case CV_64F: return py::dtype::of<double>();
+    }
+    throw py::value_error("unsupported frame depth " + std::to_string(depth));
+}
+
+// An HxW or HxWxC array over the pixels of mat, owned by base
+py::array arrayFromMat(const cv::Mat &mat, py::handle base)
+{
+    std::vector<py::ssize_t> shape = {mat.rows, mat.cols};
+    std::vector<py::ssize_t> strides = {(py::ssize_t)mat.step[0], (py::ssize_t)mat.elemSize()};
+    if (mat.channels() > 1)
+    {
+        shape.push_back(mat.channels());
+        strides.push_back((py::ssize_t)mat.elemSize1());
+    }
+
+    return py::array(dtypeFromDepth(mat.depth()), shape, strides, mat.data, base);
+}
+
+std::unique_ptr<RecordingReader> openRecording(const std::string &filename)
+{
+    std::unique_ptr<RecordingReader> reader(new RecordingReader());
+    if (!reader->open(filename))
+        throw py::value_error("cannot open recording " + filename);
+    return reader;
+}
+
+// Frame i of a recording. Raw frames are read-only arrays over the mapped file that keep
+// the reader alive, so the mapping outlives them. Compressed frames are decoded into a
+// buffer owned by the returned array.
+py::array recordingFrame(py::object self, py::ssize_t i)
+{
+    const RecordingReader &reader = self.cast<const RecordingReader &>();
+    py::ssize_t n = (py::ssize_t)reader.size();
+    if (i < 0)
+        i += n;
+    if (i < 0 || i >= n)
+        throw py::index_error("frame index out of range");
+
+    cv::Mat frame;
+    {
+        py::gil_scoped_release release;
+        frame = reader.frame((size_t)i);
+    }
+    if (frame.empty())
+        throw py::value_error("cannot decode frame " + std::to_string(i));
+
+    // No allocator behind the Mat: it points into the mapped file
+    if (frame.u == NULL)
+    {
+        py::array array = arrayFromMat(frame, self);
+        array.attr("setflags")(py::arg("write") = false);
+        return array;
+    }
+
+    cv::Mat *owner = new cv::Mat(frame);
+    py::capsule base(owner, [](void *m) { delete (cv::Mat *)m; });
+    return arrayFromMat(*owner, base);
+}
+
+uint64_t recordingTimestamp(const RecordingReader &reader, py::ssize_t i)
+{
+    py::ssize_t n = (py::ssize_t)reader.size();
+    if (i < 0)
+        i += n;
+    if (i < 0 || i >= n)
+        throw py::index_error("frame index out of range");
+    return reader.timestamp((size_t)i);
+}
+
+}
+
+PYBIND11_MODULE(aruco_native, m)
+{
+    m.doc() = "Native ArUco detection, pose, calibration loading and recording reading";
+
+    m.def("detect", &detect,
+          "Detect markers in a uint8 grey or BGR image without copying it.\n"
+          "Returns (corners (N, 4, 2) float32, ids (N, 2) int32 of (dictionary index, id)).",
+          py::arg("image"), py::arg("dictionaries") = std::vector<int>{0},
+          py::arg("tile_size") = 0, py::arg("max_marker_size") = 200);
+
+    m.def("detect_batch", &detectBatch,
+          "Detect markers in a list of images on native threads, returns a list of (corners, ids).",
+          py::arg("images"), py::arg("dictionaries") = std::vector<int>{0},
+          py::arg("tile_size") = 0, py::arg("max_marker_size") = 200);
+
+    m.def("estimate_pose", &estimatePose,
+          "Pose of single markers, returns (rvecs (N, 3), tvecs (N, 3)).",
+          py::arg("corners"), py::arg("marker_length"), py::arg("camera_matrix"), py::arg("dist_coeffs"));
+
+    m.def("load_camera_parameters", &loadCameraParameters,
+          "Read a calibrate_cam output file, returns (camera_matrix, dist_coeffs).",
+          py::arg("filename"));
+
+    // Recordings are written by capture_images -f rec. The reader only reads: capture needs
+    // a camera loop, a frame pool and a terminal, which belong in the capture_images tool.
+    // It has no open or close methods, arrays over the mapping keep the reader alive instead.
+    py::class_<RecordingReader>(m, "RecordingReader",
+                                "Frames and timestamps of a capture_images recording (-f rec).")
+        .def(py::init(&openRecording), py::arg("filename"))
+        .def("__len__", &RecordingReader::size)
+        .def("__getitem__", &recordingFrame, py::arg("index"))
+        .def("frame", &recordingFrame,
+             "Frame as an HxW or HxWxC array. Raw frames are read-only views of the file.",
+             py::arg("index"))
+        .def("timestamp", &recordingTimestamp,
+             "Capture time in nanoseconds: wall clock for a camera, position for a video file.",
+             py::arg("index"));
+}
@@ -0,0 +1,218 @@
+#ifndef ENCODER_POOL_HH
+#define ENCODER_POOL_HH
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// File extension and imwrite parameters for the selected output format
+struct EncoderOptions
+{
+    std::string extension;
+    std::vector<int> params;
+};
+
+// format: "png", "jpg" or "pnm" (raw), level: PNG compression (0-9) or JPEG quality (0-100),
+// a negative level keeps the codec default
+inline static bool makeEncoderOptions(const std::string &format, int level, EncoderOptions &opts)
+{
+    opts.params.clear();
+
+    if (format == "png")
+    {
+        opts.extension = ".png";
+        if (level >= 0)
+            opts.params = {cv::IMWRITE_PNG_COMPRESSION, std::min(level, 9)};
+    } else if (format == "jpg" || format == "jpeg")
+    {
+        opts.extension = ".jpg";
+        if (level >= 0)
+            opts.params = {cv::IMWRITE_JPEG_QUALITY, std::min(level, 100)};
+    } else if (format == "pnm" || format == "raw")
+    {
+        opts.extension = ".pnm";
+        opts.params = {cv::IMWRITE_PXM_BINARY, 1};
+    } else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Fixed set of preallocated frame buffers cycled between the capture thread and a
+// pool of encoder threads. The capture thread fills a free buffer and submits it,
+// the encoders write it out and hand the buffer back.
+class EncoderPool
+{
+public:
+    // Called on an encoder thread for every submitted frame, returns false on failure
+    typedef std::function<bool(const cv::Mat &frame, int seq, uint64_t timestamp)> Writer;
+
+    EncoderPool(int poolSize, int numThreads, Writer writer)
+        : buffers_(std::max(poolSize, 1)), writer_(writer)
+    {
+        for (int i = 0; i < (int)buffers_.size(); i++)
+            free_.push_back(i);
+
+        for (int i = 0; i < std::max(numThreads, 1); i++)
+            threads_.emplace_back(&EncoderPool::run, this);
+    }
+
+    ~EncoderPool()
+    {
+        finish();
+    }
+
+    // Allocate every buffer up front so the capture loop never allocates
+    void preallocate(cv::Size size, int type)
+    {
+        for (auto &buf : buffers_)
+            buf.create(size, type);
+    }
+
+    // Index of a free buffer, or -1 if every buffer is queued for encoding.
+    // With wait set, block until an encoder returns a buffer instead.
+    int acquire(bool wait = false)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (wait)
+            returned_.wait(lock, [this] { return !free_.empty(); });
+
+        if (free_.empty())
+            return -1;
+
+        int slot = free_.front();
+        free_.pop_front();
+        return slot;
+    }
+
+    cv::Mat &buffer(int slot)
+    {
+        return buffers_[slot];
+    }
+
+    // Hand a filled buffer to the encoders, timestamp is the capture time in nanoseconds
+    void submit(int slot, int seq, uint64_t timestamp = 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back({slot, seq, timestamp});
+        }
+        queued_.notify_one();
+    }
+
+    // Give back a buffer that was acquired but not filled
+    void release(int slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(slot);
+        }
+        returned_.notify_one();
+    }
+
+    void drop()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dropped_++;
+    }
+
+    // Encode everything still queued and join the encoder threads
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        queued_.notify_all();
+
+        for (auto &t : threads_)
+            if (t.joinable())
+                t.join();
+        threads_.clear();
+    }
+
+    size_t written()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return written_;
+    }
+
+    size_t dropped()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return dropped_;
+    }
+
+    size_t failed()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+private:
+    struct Job
+    {
+        int slot;
+        int seq;
+        uint64_t timestamp;
+    };
+
+    void run()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queued_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+
+                if (queue_.empty())
+                    return;
+
+                job = queue_.front();
+                queue_.pop_front();
+            }
+
+            bool ok = writer_(buffers_[job.slot], job.seq, job.timestamp);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                free_.push_back(job.slot);
+                if (ok)
+                    written_++;
+                else
+                    failed_++;
+            }
+            returned_.notify_one();
+        }
+    }
+
+    std::vector<cv::Mat> buffers_;
+    Writer writer_;
+
+    std::mutex mutex_;
+    std::condition_variable queued_, returned_;
+    std::deque<int> free_;
+    std::deque<Job> queue_;
+    std::vector<std::thread> threads_;
+
+    bool stop_ = false;
+    size_t written_ = 0, dropped_ = 0, failed_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,440 @@
+#ifndef FRAME_RECORDING_HH
+#define FRAME_RECORDING_HH
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <EncoderPool.hh>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Append-only container for recorded frame sessions.
+//
+//   [FileHeader][RecordHeader payload]...[RecordHeader payload][IndexEntry]...[Footer]
+//
+// Every record and payload starts on a 64 byte boundary so raw frames can be wrapped
+// in a cv::Mat straight out of the mapping. The index and footer are written on close;
+// a file without them (e.g. after a crash) is recovered by walking the records.
+// Fields are stored in host byte order.
+
+namespace {
+
+const char RECORDING_MAGIC[8] = {'A', 'R', 'F', 'R', 'A', 'M', 'E', 'S'};
+const char RECORDING_INDEX_MAGIC[8] = {'A', 'R', 'I', 'N', 'D', 'E', 'X', '1'};
+const uint32_t RECORDING_RECORD_MAGIC = 0x4d415246; // "FRAM"
+const uint32_t RECORDING_VERSION = 1;
+const size_t RECORDING_ALIGN = 64;
+
+enum RecordingEncoding
+{
+    RECORDING_RAW = 0,
+    RECORDING_PNG = 1,
+    RECORDING_JPEG = 2
+};
+
+struct RecordingFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved[13];
+};
+
+struct RecordingRecordHeader
+{
+    uint32_t magic;
+    uint32_t encoding;
+    int32_t rows, cols, type;
+    uint32_t reserved;
+    uint64_t seq;
+    uint64_t timestamp;
+    uint64_t size;
+    uint64_t padding[2];
+};
+
+struct RecordingIndexEntry
+{
+    uint64_t offset;    // payload offset from the start of the file
+    uint64_t size;      // payload size in bytes
+    uint64_t seq;
+    uint64_t timestamp; // capture time in nanoseconds
+    int32_t rows, cols, type;
+    uint32_t encoding;
+};
+
+struct RecordingFooter
+{
+    char magic[8];
+    uint64_t indexOffset;
+    uint64_t count;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(RecordingFileHeader) == RECORDING_ALIGN, "file header must stay aligned");
+static_assert(sizeof(RecordingRecordHeader) == RECORDING_ALIGN, "record header must stay aligned");
+
+inline static size_t recordingAlign(size_t n)
+{
+    return (n + RECORDING_ALIGN - 1) & ~(RECORDING_ALIGN - 1);
+}
+
+// Appends frames to a recording. append() may be called from several threads,
+// compression happens outside the lock and only the file write is serialized.
+// A failed write truncates the file back to the last complete record and stops
+// further appends, so the index written by close() still matches the file.
+class RecordingWriter
+{
+public:
+    RecordingWriter() {}
+    RecordingWriter(const RecordingWriter &) = delete;
+    RecordingWriter &operator=(const RecordingWriter &) = delete;
+
+    ~RecordingWriter()
+    {
+        close();
+    }
+
+    // encoding: RECORDING_RAW, RECORDING_PNG or RECORDING_JPEG, level is the PNG
+    // compression or JPEG quality (negative for the codec default)
+    bool open(const std::string &filename, int encoding = RECORDING_RAW, int level = -1)
+    {
+        close();
+
+        file_ = fopen(filename.c_str(), "wb");
+        if (!file_)
+            return false;
+
+        // Unbuffered, so nothing is left pending in stdio when a write has to be rolled back.
+        // Frames are written in large blocks anyway.
+        setvbuf(file_, NULL, _IONBF, 0);
+
+        encoding_ = encoding;
+        params_.clear();
+        broken_ = false;
+        offsetKnown_ = true;
+
+        EncoderOptions opts;
+        if (encoding == RECORDING_PNG && makeEncoderOptions("png", level, opts))
+            params_ = opts.params;
+        else if (encoding == RECORDING_JPEG && makeEncoderOptions("jpg", level, opts))
+            params_ = opts.params;
+
+        RecordingFileHeader header = {};
+        memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+        header.version = RECORDING_VERSION;
+
+        offset_ = 0;
+        if (!write(&header, sizeof(header)))
+        {
+            fclose(file_);
+            file_ = NULL;
+            return false;
+        }
+        return true;
+    }
+
+    bool isOpened() const
+    {
+        return file_ != NULL;
+    }
+
+    bool append(const cv::Mat &frame, uint64_t timestamp, uint64_t seq)
+    {
+        if (frame.empty())
+            return false;
+
+        cv::Mat raw;
+        std::vector<uchar> encoded;
+        const uchar *data;
+        size_t size;
+
+        if (encoding_ == RECORDING_RAW)
+        {
+            raw = frame.isContinuous() ? frame : frame.clone();
+            data = raw.data;
+            size = raw.total() * raw.elemSize();
+        } else
+        {
+            if (!cv::imencode(encoding_ == RECORDING_PNG ? ".png" : ".jpg", frame, encoded, params_))
+                return false;
+            data = encoded.data();
+            size = encoded.size();
+        }
+
+        RecordingRecordHeader header = {};
+        header.magic = RECORDING_RECORD_MAGIC;
+        header.encoding = encoding_;
+        header.rows = frame.rows;
+        header.cols = frame.cols;
+        header.type = frame.type();
+        header.seq = seq;
+        header.timestamp = timestamp;
+        header.size = size;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_ || broken_)
+            return false;
+
+        RecordingIndexEntry entry = {};
+        entry.offset = offset_ + sizeof(header);
+        entry.size = size;
+        entry.seq = seq;
+        entry.timestamp = timestamp;
+        entry.rows = frame.rows;
+        entry.cols = frame.cols;
+        entry.type = frame.type();
+        entry.encoding = encoding_;
+
+        uint64_t recordStart = offset_;
+        if (!write(&header, sizeof(header)) || !write(data, size) || !pad())
+        {
+            rollback(recordStart);
+            return false;
+        }
+
+        index_.push_back(entry);
+        return true;
+    }
+
+    // Write the trailing index, sorted by sequence number, and close the file
+    bool close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_)
+            return true;
+
+        std::stable_sort(index_.begin(), index_.end(),
+                         [](const RecordingIndexEntry &a, const RecordingIndexEntry &b) { return a.seq < b.seq; });
+
+        RecordingFooter footer = {};
+        memcpy(footer.magic, RECORDING_INDEX_MAGIC, sizeof(footer.magic));
+        footer.indexOffset = offset_;
+        footer.count = index_.size();
+
+        // With an unknown file position the index would point at the wrong bytes;
+        // leave the records for the reader to recover instead
+        bool ok = offsetKnown_ &&
+                  write(index_.data(), index_.size() * sizeof(RecordingIndexEntry)) &&
+                  write(&footer, sizeof(footer));
+
+        ok = (fclose(file_) == 0) && ok && !broken_;
+        file_ = NULL;
+        index_.clear();
+        return ok;
+    }
+
+private:
+    // Drop a partially written record so the file ends on the last complete one
+    void rollback(uint64_t recordStart)
+    {
+        broken_ = true;
+
+        offsetKnown_ = ftruncate(fileno(file_), (off_t)recordStart) == 0 &&
+                       fseeko(file_, (off_t)recordStart, SEEK_SET) == 0;
+        if (offsetKnown_)
+            offset_ = recordStart;
+    }
+
+    bool write(const void *data, size_t size)
+    {
+        if (size > 0 && fwrite(data, 1, size, file_) != size)
+            return false;
+        offset_ += size;
+        return true;
+    }
+
+    bool pad()
+    {
+        static const char zeros[RECORDING_ALIGN] = {};
+        return write(zeros, recordingAlign(offset_) - offset_);
+    }
+
+    FILE *file_ = NULL;
+    int encoding_ = RECORDING_RAW;
+    std::vector<int> params_;
+    uint64_t offset_ = 0;
+    bool broken_ = false;
+    bool offsetKnown_ = true;
+    std::vector<RecordingIndexEntry> index_;
+    std::mutex mutex_;
+};
+
+// Memory-maps a recording for random access. Raw frames are returned as cv::Mat
+// headers pointing into the mapping: they are read-only and only valid while the
+// reader is open.
+class RecordingReader
+{
+public:
+    RecordingReader() {}
+    RecordingReader(const RecordingReader &) = delete;
+    RecordingReader &operator=(const RecordingReader &) = delete;
+
+    ~RecordingReader()
+    {
+        close();
+    }
+
+    bool open(const std::string &filename)
+    {
+        close();
+
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RecordingFileHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size_ = st.st_size;
+        void *base = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+
+        if (base == MAP_FAILED)
+            return false;
+        base_ = (const uchar *)base;
+
+        const RecordingFileHeader *header = (const RecordingFileHeader *)base_;
+        if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0 ||
+            header->version != RECORDING_VERSION || !(readIndex() || recoverIndex()))
+        {
+            close();
+            return false;
+        }
+
+        return true;
+    }
+
+    bool isOpened() const
+    {
+        return base_ != NULL;
+    }
+
+    void close()
+    {
+        if (base_)
+            munmap((void *)base_, size_);
+        base_ = NULL;
+        size_ = 0;
+        index_ = NULL;
+        count_ = 0;
+        recovered_.clear();
+    }
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+    uint64_t timestamp(size_t i) const
+    {
+        return index_[i].timestamp;
+    }
+
+    // Frame i, zero-copy for raw records, decoded for compressed ones
+    cv::Mat frame(size_t i) const
+    {
+        const RecordingIndexEntry &entry = index_[i];
+        const uchar *data = base_ + entry.offset;
+
+        if (entry.encoding == RECORDING_RAW)
+            return cv::Mat(entry.rows, entry.cols, entry.type, (void *)data);
+
+        return cv::imdecode(cv::Mat(1, (int)entry.size, CV_8U, (void *)data), cv::IMREAD_UNCHANGED);
+    }
+
+private:
+    bool readIndex()
+    {
+        if (size_ < sizeof(RecordingFileHeader) + sizeof(RecordingFooter))
+            return false;
+
+        const RecordingFooter *footer = (const RecordingFooter *)(base_ + size_ - sizeof(RecordingFooter));
+        if (memcmp(footer->magic, RECORDING_INDEX_MAGIC, sizeof(footer->magic)) != 0)
+            return false;
+
+        // Bound both fields before multiplying so a corrupt footer cannot wrap around
+        size_t indexEnd = size_ - sizeof(RecordingFooter);
+        if (footer->indexOffset > indexEnd ||
+            footer->count > (indexEnd - footer->indexOffset) / sizeof(RecordingIndexEntry) ||
+            footer->indexOffset + footer->count * sizeof(RecordingIndexEntry) != indexEnd)
+            return false;
+
+        index_ = (const RecordingIndexEntry *)(base_ + footer->indexOffset);
+        count_ = footer->count;
+        return validIndex();
+    }
+
+    // Walk the records of a file that was never closed
+    bool recoverIndex()
+    {
+        size_t offset = sizeof(RecordingFileHeader);
+
+        while (offset + sizeof(RecordingRecordHeader) <= size_)
+        {
+            const RecordingRecordHeader *header = (const RecordingRecordHeader *)(base_ + offset);
+            size_t payload = offset + sizeof(RecordingRecordHeader);
+
+            if (header->magic != RECORDING_RECORD_MAGIC || header->size > size_ - payload)
+                break;
+
+            RecordingIndexEntry entry = {};
+            entry.offset = payload;
+            entry.size = header->size;
+            entry.seq = header->seq;
+            entry.timestamp = header->timestamp;
+            entry.rows = header->rows;
+            entry.cols = header->cols;
+            entry.type = header->type;
+            entry.encoding = header->encoding;
+            recovered_.push_back(entry);
+
+            offset = recordingAlign(payload + header->size);
+        }
+
+        std::stable_sort(recovered_.begin(), recovered_.end(),
+                         [](const RecordingIndexEntry &a, const RecordingIndexEntry &b) { return a.seq < b.seq; });
+
+        index_ = recovered_.data();
+        count_ = recovered_.size();
+        return validIndex();
+    }
+
+    bool validIndex() const
+    {
+        for (size_t i = 0; i < count_; i++)
+        {
+            const RecordingIndexEntry &entry = index_[i];
+            if (entry.offset > size_ || entry.size > size_ - entry.offset)
+                return false;
+            if (entry.encoding == RECORDING_RAW &&
+                (entry.rows <= 0 || entry.cols <= 0 ||
+                 (uint64_t)entry.rows * entry.cols * CV_ELEM_SIZE(entry.type) != entry.size))
+                return false;
+        }
+        return true;
+    }
+
+    const uchar *base_ = NULL;
+    size_t size_ = 0;
+    const RecordingIndexEntry *index_ = NULL;
+    size_t count_ = 0;
+    std::vector<RecordingIndexEntry> recovered_;
+};
+
+}
+
+#endif
@@ -1,10 +1,35 @@
 #include <iostream>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 
+#include <EncoderPool.hh>
+#include <FrameRecording.hh>
+
 #include <termios.h>
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/select.h>
+
+namespace {
+    const char *about =
+        "Capture images from a camera or video file\n"
+        "  Press 'space' to write the current frame, 'ESC' to quit.\n"
+        "  In burst mode every frame is written until 'ESC', Ctrl-C or -n frames.\n";
+
+    const char *keys =
+        "{b        |false  | Burst mode: write every captured frame }"
+        "{n        |0      | Number of frames to write in burst mode, 0 runs until stopped }"
+        "{v        |       | Input from video file, if ommited, input comes from camera }"
+        "{ci       |0      | Camera id if input doesnt come from video (-v) }"
+        "{f        |png    | Output format: png, jpg, pnm (raw) or rec (single recording file) }"
+        "{q        |-1     | PNG compression level (0-9) or JPEG quality (0-100), -1 for the codec default }"
+        "{re       |raw    | Frame encoding inside a recording (-f rec): raw, png or jpg }"
+        "{t        |2      | Number of encoder threads }"
+        "{p        |16     | Number of preallocated frame buffers }"
+        "{o        |image  | Output file prefix }"
+        "{help h usage ? |  | print this message }";
+}
 
 static volatile sig_atomic_t done = 0;
 
@@ -13,58 +38,214 @@ void handlr(int sig)
     done = 1;
 }
 
+// Read a key from stdin if one is available, without blocking the capture loop
+static int pollKey()
+{
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+
+    struct timeval tv = {0, 0};
+    if (select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) <= 0)
+        return -1;
+
+    char k;
+    if (read(STDIN_FILENO, &k, 1) != 1)
+        return -1;
+
+    return k;
+}
+
 int main(int argc, char **argv)
 {
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about(about);
+
+    if (parser.has("help"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+
+    bool burst = parser.get<bool>("b");
+    int numFrames = parser.get<int>("n");
+    int camId = parser.get<int>("ci");
+    int numThreads = parser.get<int>("t");
+    int poolSize = parser.get<int>("p");
+    std::string prefix = parser.get<std::string>("o");
+
+    cv::String video;
+    if (parser.has("v"))
+        video = parser.get<cv::String>("v");
+
+    std::string format = parser.get<std::string>("f");
+    int level = parser.get<int>("q");
+    bool record = format == "rec";
+
+    EncoderOptions encoderOpts;
+    if (!record && !makeEncoderOptions(format, level, encoderOpts))
+    {
+        std::cerr << "Unknown output format " << format << std::endl;
+        return -1;
+    }
+
+    std::string recordEncoding = parser.get<std::string>("re");
+    int encoding;
+    if (recordEncoding == "raw")
+        encoding = RECORDING_RAW;
+    else if (recordEncoding == "png")
+        encoding = RECORDING_PNG;
+    else if (recordEncoding == "jpg" || recordEncoding == "jpeg")
+        encoding = RECORDING_JPEG;
+    else
+    {
+        std::cerr << "Unknown recording encoding " << recordEncoding << std::endl;
+        return -1;
+    }
+
+    if (!parser.check())
+    {
+        parser.printErrors();
+        return 0;
+    }
+
     // Terminal Interface
     static struct termios curr_t, new_t;
-    tcgetattr(STDIN_FILENO, &curr_t);
-    new_t = curr_t;
-    new_t.c_lflag &= ~ICANON;
-    tcsetattr(STDIN_FILENO, 0, &new_t);
+    bool tty = isatty(STDIN_FILENO);
+    if (tty)
+    {
+        tcgetattr(STDIN_FILENO, &curr_t);
+        new_t = curr_t;
+        new_t.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, 0, &new_t);
+    }
 
-    struct sigaction act;
+    struct sigaction act = {};
     act.sa_handler = handlr;
     sigaction(SIGINT, &act, NULL);
 
-    // Grab the camera stream
-    cv::VideoCapture cap(0);
+    // Grab the camera stream, or the video file
+    cv::VideoCapture cap;
+    if (!video.empty())
+        cap.open(video);
+    else
+        cap.open(camId);
 
     if (!cap.isOpened())
     {
         std::cout << "No video stream detected" << std::endl;
+        if (tty)
+            tcsetattr(STDIN_FILENO, 0, &curr_t);
         return -1;
     }
 
-    cv::Mat frame;
+    // All frames of a session go into one indexed file instead of one image per frame.
+    // Opening truncates, so only do it once the arguments and the input are known good.
+    RecordingWriter recording;
+    if (record && !recording.open(prefix + ".rec", encoding, level))
+    {
+        std::cerr << "Cannot open recording " << prefix << ".rec" << std::endl;
+        if (tty)
+            tcsetattr(STDIN_FILENO, 0, &curr_t);
+        return -1;
+    }
+
+    // A camera keeps running whether or not we keep up, so a full pool drops the frame.
+    // A video file has no such deadline and waits for a free buffer instead.
+    bool waitForBuffer = !video.empty();
+
+    EncoderPool pool(poolSize, numThreads, [&](const cv::Mat &frame, int seq, uint64_t timestamp) {
+        if (record)
+            return recording.append(frame, timestamp, seq);
+        return cv::imwrite(prefix + "_" + std::to_string(seq) + encoderOpts.extension, frame, encoderOpts.params);
+    });
+
     int seq = 0;
+    int captured = 0;
+    bool sized = false;
+    auto start = std::chrono::steady_clock::now();
 
-    while (true)
+    while (!done)
     {
-        cap >> frame;
+        int k = pollKey();
 
-        // No frame
-        if (frame.empty())
+        if (k == 27)
             break;
 
-        char k = getchar();
-        std::cout << k << std::endl;
+        bool save = burst || k == 32;
 
-        if (k == 27)
-            break;
+        if (!save)
+        {
+            if (!cap.grab())
+                break;
+            captured++;
+            continue;
+        }
+
+        int slot = pool.acquire(waitForBuffer);
 
-        if (k == 32)
+        // Every buffer is still queued for encoding, skip this frame
+        if (slot < 0)
         {
-            cv::imwrite("image_"+std::to_string(seq)+".png", frame);
-            seq++;
-            std::cout << "Image wrote!" << std::endl;
+            if (!cap.grab())
+                break;
+            captured++;
+            pool.drop();
+            continue;
         }
 
+        cv::Mat &frame = pool.buffer(slot);
+        if (!cap.read(frame) || frame.empty())
+        {
+            pool.release(slot);
+            break;
+        }
+        captured++;
+
+        // Capture time: position in the file for video, wall clock for a camera
+        uint64_t timestamp;
+        if (!video.empty())
+            timestamp = (uint64_t)(cap.get(cv::CAP_PROP_POS_MSEC) * 1e6);
+        else
+            timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // The first frame tells us the size of the remaining buffers
+        if (!sized)
+        {
+            pool.preallocate(frame.size(), frame.type());
+            sized = true;
+        }
+
+        pool.submit(slot, seq, timestamp);
+        seq++;
+
+        if (!burst)
+            std::cout << "Image queued!" << std::endl;
+
+        if (burst && numFrames > 0 && seq >= numFrames)
+            break;
     }
 
+    // Wait for the encoders to drain the queue
+    pool.finish();
+
+    if (record && !recording.close())
+        std::cerr << "Cannot write recording index" << std::endl;
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Frames captured: " << captured
+              << " (" << (elapsed > 0 ? captured / elapsed : 0) << " fps)" << std::endl;
+    std::cout << "Images written: " << pool.written() << std::endl;
+    std::cout << "Frames dropped: " << pool.dropped() << std::endl;
+    if (pool.failed() > 0)
+        std::cerr << "Failed writes: " << pool.failed() << std::endl;
+
     // Reset the terminal mode to what it was before
-    tcsetattr(STDIN_FILENO, 0, &curr_t);
+    if (tty)
+        tcsetattr(STDIN_FILENO, 0, &curr_t);
 
     cap.release();
     return 0;
 }
-